@@ -1,4 +1,5 @@
 #include <string.h>
+#include <ctype.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/time.h>
@@ -10,8 +11,17 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <ucontext.h>
+#include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <new>
 #include <iostream>
 
 
@@ -19,9 +29,13 @@ uint32_t N_GENERATIONS = 100;
 uint32_t N_MUTATIONS = 5;
 uint32_t N_ALLOWED_GENES = 1;
 uint32_t timeout = 2;
+uint32_t evaluator_timeout_ms = 100;   // timeout of each fitness input in the server mode
+uint64_t N_VALIDATION_INPUTS = 1000000;
+uint64_t validation_seed = 1;
+static thread_local uint32_t random_seed;  // state of generateRandomNumber(), each thread mutates with its own
 
 struct Instruction {
-    std::vector <uint8_t> instr;
+    uint8_t instr[15]; // Fixed storage so that copying a chromossome does not allocate per instruction
     uint8_t size:4; // Maximum size of x86 instructions are 15bytes, 15 = 1111 = 4 bits 
 };
 struct MetadataJump{
@@ -42,6 +56,7 @@ std::map <uint8_t, uint8_t> instruction_sizes_map = {
     {0x49, 3},  // inc regx; cmp regx, reg     
     {0x4D, 3},  // xor regx, regx
     {0x66, 4},  // movi 
+    {0xB8, 5},  // mov eax, im32
     {0xE9, 5},  // jmp im32
     {0x0F, 6},   // jae im32
     {0x50, 1},
@@ -63,6 +78,123 @@ std::map <uint8_t, uint8_t> instruction_sizes_map = {
 };
 
 
+// Gene pool. Every (operation, reg_x, reg_y) combination is encoded once, at compile time, so that
+// picking a gene is a single random index. Operations that use only reg_x (or no register at all) are
+// still repeated for every reg_y, which keeps the chance of each operation the same (1/16).
+// rax (0) is avoided because we know that is the most used register
+// rsp (4) and rbp (5) are also avoided because they can mess with the stack
+enum GeneOperation : uint8_t {
+    GENE_INC,       // REX.W FF /0
+    GENE_DEC,       // REX.W FF /1
+    GENE_CMP_RR,    // REX.W 39 /r
+    GENE_XOR_RR,    // REX.W 31 /r
+    GENE_XOR_RI,    // REX.W 81 /6 id
+    GENE_ADD_RR,    // REX.W 01 /r
+    GENE_ADD_RI,    // REX.W 81 /0 id
+    GENE_BSWAP,     // REX.W 0F C8+rd
+    GENE_NOT,       // REX.W F7 /2
+    GENE_NEG,       // REX.W F7 /3
+    GENE_SUB_RR,    // REX.W 29 /r
+    GENE_AND_RR,    // REX.W 21 /r
+    GENE_AND_RI,    // REX.W 81 /4 id
+    GENE_OR_RR,     // REX.W 09 /r
+    GENE_OR_RI,     // REX.W 81 /1 id
+    GENE_CLC,       // F8
+    N_GENE_OPERATIONS
+};
+
+constexpr uint8_t gene_registers[] = {1, 2, 3, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+constexpr uint32_t N_GENE_REGISTERS = sizeof(gene_registers);
+constexpr uint32_t N_GENE_ENCODINGS = N_GENE_OPERATIONS * N_GENE_REGISTERS * N_GENE_REGISTERS;
+
+struct Gene {
+    uint8_t bytes[7];   // The longest gene is REX + opcode + ModRM + im32
+    uint8_t size;
+    uint8_t imm_offset; // Where the im32 starts, 0 if the gene has none
+};
+
+struct GeneTable {
+    Gene genes[N_GENE_ENCODINGS];
+};
+
+// Builds the encoding of a single gene
+constexpr Gene encodeGene(uint8_t operation, uint8_t reg_x, uint8_t reg_y){
+
+    // 0100100X (reg_x in r/m) and 01001X0Y (reg_x in reg, reg_y in r/m)
+    const uint8_t rex_x  = (0b01001000) | ((reg_x & 0x8) >> 3);
+    const uint8_t rex_xy = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3);
+    // 11XXXYYY
+    const uint8_t modrm_xy = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
+
+    Gene gene = {};
+    switch (operation){
+        case GENE_INC:    gene = {{rex_x, 0xFF, (uint8_t)(0b11000000 | (reg_x & 0x7))}, 3, 0}; break;
+        case GENE_DEC:    gene = {{rex_x, 0xFF, (uint8_t)(0b11001000 | (reg_x & 0x7))}, 3, 0}; break;
+        case GENE_CMP_RR: gene = {{rex_xy, 0x39, modrm_xy}, 3, 0}; break;
+        case GENE_XOR_RR: gene = {{rex_xy, 0x31, modrm_xy}, 3, 0}; break;
+        case GENE_XOR_RI: gene = {{rex_x, 0x81, (uint8_t)(0b11110000 | (reg_x & 0x7))}, 7, 3}; break;
+        case GENE_ADD_RR: gene = {{rex_xy, 0x01, modrm_xy}, 3, 0}; break;
+        case GENE_ADD_RI: gene = {{rex_x, 0x81, (uint8_t)(0b11000000 | (reg_x & 0x7))}, 7, 3}; break;
+        case GENE_BSWAP:  gene = {{rex_x, 0x0F, (uint8_t)(0b11001000 | (reg_x & 0x7))}, 3, 0}; break;
+        case GENE_NOT:    gene = {{rex_x, 0xF7, (uint8_t)(0b11010000 | (reg_x & 0x7))}, 3, 0}; break;
+        case GENE_NEG:    gene = {{rex_x, 0xF7, (uint8_t)(0b11011000 | (reg_x & 0x7))}, 3, 0}; break;
+        case GENE_SUB_RR: gene = {{rex_xy, 0x29, modrm_xy}, 3, 0}; break;
+        case GENE_AND_RR: gene = {{rex_xy, 0x21, modrm_xy}, 3, 0}; break;
+        case GENE_AND_RI: gene = {{rex_x, 0x81, (uint8_t)(0b11100000 | (reg_x & 0x7))}, 7, 3}; break;
+        case GENE_OR_RR:  gene = {{rex_xy, 0x09, modrm_xy}, 3, 0}; break;
+        case GENE_OR_RI:  gene = {{rex_x, 0x81, (uint8_t)(0b11001000 | (reg_x & 0x7))}, 7, 3}; break;
+        case GENE_CLC:    gene = {{0xF8}, 1, 0}; break;
+    }
+    return gene;
+}
+
+constexpr GeneTable buildGeneTable(){
+    GeneTable table = {};
+    uint32_t idx = 0;
+    for(uint8_t op = 0; op < N_GENE_OPERATIONS; op++){
+        for(uint32_t x = 0; x < N_GENE_REGISTERS; x++){
+            for(uint32_t y = 0; y < N_GENE_REGISTERS; y++){
+                table.genes[idx++] = encodeGene(op, gene_registers[x], gene_registers[y]);
+            }
+        }
+    }
+    return table;
+}
+
+constexpr GeneTable gene_table = buildGeneTable();
+
+struct GeneReference {
+    uint8_t bytes[7];
+    uint8_t size;
+};
+
+constexpr GeneReference gene_corpus[] = {
+#include "gene_corpus.inc"
+};
+static_assert(sizeof(gene_corpus) / sizeof(GeneReference) == N_GENE_ENCODINGS, "gene_corpus must have one entry per gene");
+
+// Compares every gene against the reference encodings. The im32 bytes are random (patched in selectRandomGene()),
+// so there the reference must have the placeholder instead
+constexpr bool geneTableMatchesCorpus(){
+    const uint8_t placeholder[4] = {0x44, 0x33, 0x22, 0x11};
+    for(uint32_t idx = 0; idx < N_GENE_ENCODINGS; idx++){
+        const Gene &gene = gene_table.genes[idx];
+        const GeneReference &reference = gene_corpus[idx];
+        if(gene.size != reference.size) return false;
+        for(uint8_t i = 0; i < gene.size; i++){
+            if(gene.imm_offset != 0 && i >= gene.imm_offset){
+                if(reference.bytes[i] != placeholder[i - gene.imm_offset]) return false;
+            }else if(gene.bytes[i] != reference.bytes[i]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(geneTableMatchesCorpus(), "gene_table differs from the reference encodings in gene_corpus.inc");
+
+
 //Variables used in the logic of the threads used
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
@@ -75,15 +207,250 @@ typedef struct {
     uint32_t n;
 } thread_arg_t, *ptr_thread_arg_t;
 
+//Variables and structures used in the differential validation of the output code
+#define MAX_VALIDATION_EXPONENT 64  // the input code loops n times, so n is kept small to validate many inputs
+#define MAX_SHRINK_STEPS 4096       // inputs tried while shrinking a divergence
+#define MAX_SHRINK_MS 10000         // time spent shrinking a divergence
+
+typedef uint64_t (*jit_function_t)(uint64_t, uint64_t, uint64_t);
+
+// Calls jit(b, n, p) with fixed sentinels in the callee-saved registers and restores them afterwards. *clobbered is not 0
+// if the code did not give the sentinels back, which happens when a gene is inserted after their "pop". The sentinels
+// are nonzero and have different bytes at each end, so genes like bswap, not or neg always change them, and the result
+// does not depend on what the caller had in those registers
+extern "C" uint64_t callJitFunction(jit_function_t jit, uint64_t b, uint64_t n, uint64_t p, uint64_t *clobbered);
+asm(R"(
+    .text
+    .globl callJitFunction
+    .type callJitFunction, @function
+    .intel_syntax noprefix
+callJitFunction:
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    push r8
+    mov rax, rdi
+    mov rdi, rsi
+    mov rsi, rdx
+    mov rdx, rcx
+    movabs rbx, 0x0123456789ABCDEF
+    movabs rbp, 0x13579BDF02468ACE
+    movabs r12, 0x2468ACE013579BDF
+    movabs r13, 0x3C1E0F8796A5B4D2
+    movabs r14, 0x4D2B3A59687F1E0C
+    movabs r15, 0x5E6F708192A3B4C5
+    call rax
+    pop r8
+    movabs r9, 0x0123456789ABCDEF
+    xor r9, rbx
+    movabs r10, 0x13579BDF02468ACE
+    xor r10, rbp
+    or r9, r10
+    movabs r10, 0x2468ACE013579BDF
+    xor r10, r12
+    or r9, r10
+    movabs r10, 0x3C1E0F8796A5B4D2
+    xor r10, r13
+    or r9, r10
+    movabs r10, 0x4D2B3A59687F1E0C
+    xor r10, r14
+    or r9, r10
+    movabs r10, 0x5E6F708192A3B4C5
+    xor r10, r15
+    or r9, r10
+    mov [r8], r9
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+    .att_syntax prefix
+    .size callJitFunction, .-callJitFunction
+)");
+
+struct ValidationInput {
+    uint64_t b, n, p;   // rdi = b , rsi = n , rdx = p
+};
+
+enum DivergenceKind : uint8_t {
+    DIVERGENCE_NONE,
+    DIVERGENCE_RESULT,  // both returned, but the values differ
+    DIVERGENCE_FAULT,   // the code raised a signal where the reference returns a value
+    DIVERGENCE_NO_FAULT,// the reference divides by zero but the code returned a value
+    DIVERGENCE_TIMEOUT, // the code did not return within the timeout
+    DIVERGENCE_CLOBBER  // the code returned with a callee-saved register (rbx, rbp, r12-r15) changed
+};
+
+struct Divergence {
+    DivergenceKind kind;
+    uint64_t index;     // position of the input in the corpus
+    ValidationInput input;
+    uint64_t expected;
+    uint64_t got;       // returned value, or the signal number for DIVERGENCE_FAULT
+};
+
+// A thread that runs code, as seen by the watcher that interrupts it (with SIGUSR1) when an input takes too long.
+// The interrupt names the input it is meant for, so it is ignored if that input has already finished
+typedef struct {
+    pthread_t thread;
+    volatile uint8_t busy;              // 1 while the thread is running inputs
+    volatile uint64_t input_seq;        // incremented by checkCodeOutput() for every input
+    volatile uint64_t interrupt_seq;    // the input the watcher wants to interrupt
+    uint64_t last_seq, last_change;     // used only by the watcher
+} runner_watch_t;
+
+typedef struct {
+    jit_function_t jit;
+    uint64_t seed;
+    uint64_t *first_failure;    // lowest corpus index known to diverge, shared by all the shards
+    uint64_t begin, end;        // the shard of the corpus [begin, end)
+    runner_watch_t watch;
+    volatile uint8_t done;
+    Divergence divergence;
+} validation_arg_t;
+
+static thread_local sigjmp_buf validation_jmp;
+static thread_local volatile sig_atomic_t validation_in_jit; // only jump back to validation_jmp while the code is running
+static thread_local runner_watch_t *current_runner;          // the watch of this thread, if it has one
+runner_watch_t threadRunnerWatch;                            // the watch of threadRunner in the command line mode
+
+// Fitness suite of the command line mode and of the jobs without TEST lines: the example of the original code plus a
+// few edge inputs, so that a mutation is also checked with a divide by zero and with all the 64 bits of b, n and p
+static const ValidationInput default_fitness_inputs[] = {
+    {2, 12, 10},
+    {1, 1, 0},
+    {3, 0, 7},
+    {0x100000000, 3, 0xFFFFFFFF},
+    {UINT64_MAX, MAX_VALIDATION_EXPONENT, UINT64_MAX - 1},
+    {0x8000000000000000, MAX_VALIDATION_EXPONENT - 1, 0x100000000},
+};
+
+//Variables and structures used in the server mode
+#define MAX_JOB_BYTES 4096
+#define MAX_JOB_TESTS 64
+#define MAX_JOB_GENERATIONS 1000
+#define MAX_JOB_MUTATIONS 1000
+#define MAX_JOB_ALLOWED_GENES 1000
+#define MAX_JOB_TASKS (1 << 20)         // mutations in one generation (the population can grow with the generations)
+#define MAX_JOB_POPULATION_INSTRUCTIONS (1 << 24)   // instructions in all the chromossomes of one generation
+#define MAX_JOB_VALIDATION_INPUTS (1ULL << 28) // about a minute of one core
+#define VALIDATION_TASK_INPUTS 65536    // inputs of the corpus checked by one validation task
+#define MAX_DECODED_CACHE 256           // input codes kept decoded, the least recently used is dropped first
+#define JOB_POLL_MS 100                 // how often a running job checks that its client is still connected
+
+// One input of the fitness suite of a job, with the result of the reference computed when the job is read
+struct FitnessTest {
+    ValidationInput input;
+    uint64_t expected;
+    uint8_t expect_fault;
+};
+
+// What the tasks of a job do in its current phase
+enum JobPhase : uint8_t {
+    JOB_PHASE_MUTATION,     // task t is the mutation t % N_MUTATIONS of the chromossome t / N_MUTATIONS
+    JOB_PHASE_VALIDATION,   // task t checks the inputs [t, t + 1) * VALIDATION_TASK_INPUTS of the output code
+    JOB_PHASE_SHRINK        // a single task shrinks the failing input found by the validation
+};
+
+// Why a job stopped before the end
+enum JobCancel : uint8_t {
+    JOB_NOT_CANCELLED,
+    JOB_OUT_OF_MEMORY,      // an allocation failed
+    JOB_CLIENT_GONE         // the client closed the connection, or a write to it failed
+};
+
+// A job sent by a client. The session thread of the client owns it, the workers only run its tasks
+struct Job {
+    uint32_t id;
+    int32_t client_fd;
+    uint32_t n_generations, n_mutations, n_allowed_genes;
+    uint64_t seed;
+    uint64_t n_validation_inputs;
+    std::vector<FitnessTest> tests;         // the fitness suite
+    std::vector<Chromossome> population;
+
+    uint32_t generation;
+    uint32_t n_tasks, next_task, finished_tasks;
+    uint8_t phase;
+    volatile uint8_t cancelled;             // a JobCancel, once set the tasks not started yet are dropped
+    std::vector<Chromossome> children;      // only the apt ones are kept
+    std::vector<uint8_t> apt;
+
+    std::vector<uint8_t> output;            // the output code, run by the validation and shrink tasks
+    uint64_t first_failure;                 // lowest corpus index known to diverge, shared by the validation tasks
+    Divergence failure;                     // the divergence at first_failure, shrunk by the shrink task
+    pthread_cond_t finished;
+};
+
+// A warm worker: the executable memory it reuses for every task and the watch of its thread (busy only while it runs
+// the tests of a task), read by pthreadWatchEvaluators()
+typedef struct {
+    uint8_t *arena;
+    uint32_t arena_length;
+    runner_watch_t watch;
+} evaluator_t;
+
+pthread_mutex_t scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t scheduler_cond = PTHREAD_COND_INITIALIZER;
+std::deque<Job*> runnable_jobs;     // jobs with tasks left, served in round robin
+std::vector<evaluator_t> evaluators;
+
+pthread_mutex_t decoded_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct DecodedCacheEntry {
+    Chromossome chromossome;                // decoded instructions and jumps
+    std::list<std::string>::iterator lru;   // position of the key in decoded_lru
+};
+std::map<std::string, DecodedCacheEntry> decoded_cache;    // input bytes -> decoded code
+std::list<std::string> decoded_lru;                         // keys of decoded_cache, most recently used first
+uint32_t job_counter = 0;
+
 //
-void printInstructionVector(const std::vector<Instruction> &vec);
-void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vector, uint32_t size);
+void printInstructionVector(const std::vector<Instruction> &vec, FILE *out = stdout);
+void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vector, uint32_t size, uint8_t verbose = 0);
 void addSourceCodeToArray(uint8_t* sourcecode, FILE *file);
-void printInstructionVector(const std::vector<Instruction> &vec);
 void remapJumpLocations(uint32_t newline, uint8_t nbytes, std::vector<Instruction> &vec, std::vector<MetadataJump> &jumps_metadata);
 void copyVectorToArray(uint8_t *code2memory, std::vector<Instruction> &chromossome);
 void executeInMemory(std::vector<Instruction> &chromossome);
 
+uint8_t* readHexFile(const char *filename, uint32_t &n);
+uint8_t validateCode(uint8_t *code, uint32_t n, uint64_t n_inputs, uint64_t seed, FILE *out = stdout);
+void getValidationInput(uint64_t seed, uint64_t index, ValidationInput &input);
+uint8_t referenceModexp(const ValidationInput &input, uint64_t &result);
+uint8_t checkValidationInput(jit_function_t jit, const ValidationInput &input, Divergence &divergence);
+uint8_t checkCodeOutput(jit_function_t jit, const ValidationInput &input, uint64_t expected, uint8_t expect_fault, Divergence &divergence);
+void validateInputs(jit_function_t jit, uint64_t seed, uint64_t begin, uint64_t end, uint64_t *first_failure, Divergence &divergence);
+void shrinkDivergence(jit_function_t jit, Divergence &divergence);
+void printValidationReport(FILE *out, uint64_t n_inputs, uint64_t seed, double elapsed, uint32_t n_threads, const Divergence *divergence);
+void startRunnerWatch(runner_watch_t &watch);
+void watchRunner(runner_watch_t &watch, uint64_t now, uint64_t timeout_ms);
+void *pthreadValidateShard(void* _args);
+void *pthreadShrinkDivergence(void* _args);
+void superviseValidation(validation_arg_t *workers, uint32_t n_workers, pthread_t *threads, uint64_t timeout_ms);
+static void sigaction_validation(int signal, siginfo_t *si, void *arg);
+void setValidationSignalHandlers();
+
+uint64_t getMonotonicMilliseconds();
+uint8_t isSourceCodeSupported(const uint8_t *sourcecode, uint32_t size);
+uint8_t areJumpsSupported(const std::vector<Instruction> &vec);
+uint8_t decodeSourceCode(const std::vector<uint8_t> &sourcecode, Chromossome &chromossome);
+uint8_t readJob(FILE *in, Job &job, std::vector<uint8_t> &sourcecode);
+void runJob(Job &job, FILE *out);
+void runJobTasks(Job &job, uint8_t phase, uint32_t n_tasks);
+uint8_t isClientGone(int32_t fd);
+void openArena(evaluator_t &evaluator, uint32_t size);
+uint8_t evaluateTask(evaluator_t &evaluator, Job &job, uint32_t task);
+void validateTask(evaluator_t &evaluator, Job &job, uint32_t task);
+void shrinkTask(evaluator_t &evaluator, Job &job);
+void *pthreadEvaluator(void* args);
+void *pthreadWatchEvaluators(void* args);
+void *pthreadServeClient(void* args);
+int32_t runServer(const char *socket_path);
+
 void mutate(Chromossome &current);
 void selectRandomGene(Instruction &aux, uint32_t random_line);
 
@@ -102,11 +469,12 @@ inline uint32_t generateRandomNumber(uint32_t min, uint32_t max);
 
 // Gets the size of a instruction. This is hardcoded and must be changed to work with other inputs
 uint8_t getSizeOfInstruction(uint8_t opcode){
-    return instruction_sizes_map[opcode];
+    auto it = instruction_sizes_map.find(opcode);
+    return it == instruction_sizes_map.end() ? 0 : it->second;
 }
 
-// Adds the x86 hex code to a Vector of Instruction
-void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vector, uint32_t size){
+// Adds the x86 hex code to a Vector of Instruction. With verbose it prints the offset of each instruction (command line only)
+void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vector, uint32_t size, uint8_t verbose){
 
     uint32_t i = 0, j = 0;
     while ( i < size){
@@ -115,10 +483,10 @@ void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vec
 
         aux.size = j;
         for(uint32_t k = 0; k < j; k++){
-            aux.instr.push_back(sourcecode[i + k]);
+            aux.instr[k] = sourcecode[i + k];
         }
 
-        printf("sourcecode %.2X ---> i %d\n", sourcecode[i], i);
+        if(verbose) printf("sourcecode %.2X ---> i %d\n", sourcecode[i], i);
         to_vector.push_back(aux);
 
         i += j;
@@ -126,14 +494,14 @@ void addSourceCodeToVector(uint8_t* sourcecode, std::vector<Instruction> &to_vec
 }
 
 // Prints in groups of 2 bytes all the instructions contained in &vec
-void printInstructionVector(const std::vector<Instruction> &vec){
+void printInstructionVector(const std::vector<Instruction> &vec, FILE *out){
 
     for(std::size_t i = 0; i < vec.size() ; ++i){
         // printf("%d: ", i);
-        for (uint32_t j = 0; j < vec[i].instr.size(); j++){
-            printf("%.2X ", vec[i].instr[j]);
+        for (uint32_t j = 0; j < vec[i].size; j++){
+            fprintf(out, "%.2X ", vec[i].instr[j]);
         }
-        printf("\n");
+        fprintf(out, "\n");
     } 
 }
 
@@ -167,9 +535,9 @@ void mapJumpLocations(const std::vector<Instruction> &vec, std::vector<MetadataJ
 
     for (uint32_t line = 0; line < vec.size(); line++ ){
 
-        std::vector<uint8_t> instr = vec[line].instr; 
+        const uint8_t *instr = vec[line].instr; 
         uint8_t opcode = instr[0];
-        uint32_t size = instr.size();
+        uint32_t size = vec[line].size;
         int32_t value = 0x0;
         MetadataJump meta_aux;
 
@@ -209,7 +577,7 @@ void remapJumpLocations(uint32_t newline, uint8_t nbytes, std::vector<Instructio
             if(newline > src_line && newline <= dest_line){ // we need to alter dest_line and value
 
                 //FIXME: search for correct information about instruction size (it is now hardcoded)
-                uint8_t instr_size = instruction_sizes_map[0x0f];
+                uint8_t instr_size = getSizeOfInstruction(0x0f);
 
                 rel_value += nbytes;
 
@@ -229,7 +597,7 @@ void remapJumpLocations(uint32_t newline, uint8_t nbytes, std::vector<Instructio
             if(newline <= src_line && newline > dest_line){
 
                 //FIXME: search for correct information about instruction size (it is now hardcoded)
-                uint8_t instr_size = instruction_sizes_map[0xe9];
+                uint8_t instr_size = getSizeOfInstruction(0xe9);
 
                 rel_value -= nbytes;
 
@@ -251,7 +619,7 @@ void remapJumpLocations(uint32_t newline, uint8_t nbytes, std::vector<Instructio
 //Returns a random number between min and max ie. [min, max] 
 inline uint32_t generateRandomNumber(uint32_t min, uint32_t max){ 
     // return rand() % (max)  + min;
-    return (rand() % (max + 1 - min)) + min;
+    return (rand_r(&random_seed) % (max + 1 - min)) + min;
 }
 
 // Copies a vector of type Instruction into an array of type uint8_t
@@ -260,8 +628,8 @@ void copyVectorToArray(uint8_t *code2memory, std::vector<Instruction> &chromosso
     uint32_t idx = 0; 
     for ( auto &elem : chromossome ) {
 
-        uint8_t* pos = elem.instr.data();
-        for(uint32_t i = 0; i < elem.instr.size(); i++){
+        uint8_t* pos = elem.instr;
+        for(uint32_t i = 0; i < elem.size; i++){
             code2memory[idx++] = *pos++;
         }
     }
@@ -293,15 +661,13 @@ void executeInMemory(std::vector<Instruction> &chromossome){
     munmap ( memory , length ) ;
 }
 
-// Sets the thread cancel mode to assynchronous and Executes in memory a vector passed by reference containing bytes correspondent to x86 instructions  
+// Executes in memory a vector passed by reference containing bytes correspondent to x86 instructions, with the same
+// fitness check as the server: default_fitness_inputs must give the same results as referenceModexp(), without
+// changing the callee-saved registers. Returns 1 if the code is apt
 void* pthreadExecuteInMemory(void* _args){
 
     isThreadRunnerAlive = 1;
-    
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-    setSignalHanlder(SIGFPE);
-    usleep(100);
+    startRunnerWatch(threadRunnerWatch);
 
     ptr_thread_arg_t ptr_args = (ptr_thread_arg_t) _args;
 
@@ -311,44 +677,31 @@ void* pthreadExecuteInMemory(void* _args){
     memcpy ( memory , ( void *) ( ptr_args->ptr ) , sizeof(uint8_t)*ptr_args->n );
     mprotect ( memory , length , PROT_EXEC );
 
+    jit_function_t jit = (jit_function_t) memory;
 
-    const uint64_t (* jit ) ( const uint32_t , const uint32_t , const uint64_t ) = 
-        ( const uint64_t (*) ( const uint32_t , const uint32_t , const uint64_t ) ) ( memory ) ;
-
-    uint64_t retval = 0;
-    retval = (*jit)(2, 12, 10);
+    Divergence divergence;
+    uint64_t retval = 1;
+    for(const ValidationInput &input : default_fitness_inputs){
+        if(!checkValidationInput(jit, input, divergence)){
+            retval = 0;
+            break;
+        }
+    }
 
+    threadRunnerWatch.busy = 0;
+    current_runner = NULL;
     munmap ( memory , length ) ;
     // pthread_cond_signal(&cond);
     isThreadRunnerAlive = 0;
     pthread_exit ( (void *) retval );
 }
 
-// Kills a thread if a given time has elapsed (global timeout variable)
+// Interrupts threadRunner (with SIGUSR1, see sigaction_validation()) if a given time has elapsed (global timeout variable)
 void *pthreadWaitOrKill(void* args){
 
-    // clock_t start, end;
-    // double cpu_time_used;
-    volatile time_t begin = NULL, end = NULL;
-    
-    begin = time(NULL);
-    
-    //     start = clock();
-    
-    while (true){
-        // pthread_mutex_trylock(&mutex);
-        // end = clock();
+    while (isThreadRunnerAlive){
         usleep(100);
-        end = time(NULL);
-
-        // cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-        if(isThreadRunnerAlive == 0 ){
-            break;
-        }else if(end - begin >= timeout){
-            pthread_cancel( threadRunner );
-            break;
-        }
-        // pthread_mutex_unlock(&mutex);
+        watchRunner(threadRunnerWatch, getMonotonicMilliseconds(), timeout * 1000);
         sched_yield();
     }
     pthread_exit(NULL);
@@ -372,161 +725,17 @@ void *pthreadWaitWithTimeoutAndCond(void* args){
     pthread_exit(NULL);
 }
 
-// Inserts in *aux a random instruction (gene). It is defined here all the instructions that can be inserted
+// Inserts in *aux a random instruction (gene). The instructions that can be inserted are defined in gene_table
 void selectRandomGene(Instruction &aux, uint32_t random_line){
 
-    // rax (0) is avoided because we know that is the most used register
-    // rsp (4) and rbp (5) are also avoided because they can mess with the stack
-    uint8_t reg_y, reg_x;
-    do{
-        reg_x = generateRandomNumber(1, 15);
-    }while(reg_x == 4 || reg_x == 5);
+    const Gene &gene = gene_table.genes[generateRandomNumber(0, N_GENE_ENCODINGS - 1)];
+    memcpy(aux.instr, gene.bytes, sizeof(gene.bytes));
+    aux.size = gene.size;
 
-    do{
-        reg_y = generateRandomNumber(1, 15);
-    }while(reg_y == 4 || reg_y == 5);
-    
-    uint32_t randomValue = generateRandomNumber(0, RAND_MAX); // a random value to add when a IM32 is needed
-
-    uint32_t randomInstruction = generateRandomNumber(0, 15);   // 15 is the number of decoded instructions 
-    uint8_t ext;
-    uint8_t regs;
-    uint8_t byte;
-
-    switch (randomInstruction){
-        case 0: //INC reg
-            //0100100X 11111111 11000XXX
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11000000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0xFF , regs };
-        break;
-        case 1: //DEC reg
-            //0100100X 11111111 11001XXX
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11001000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0xFF , regs };
-        break;
-
-        case 2: //CMP reg, reg
-            // 01001X0Y 00111001 11XXXYYY
-            ext = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3 );
-            regs = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
-            aux.instr = {ext , 0x39 , regs};
-        break;
-        
-        case 3: // XOR reg, reg
-            // 01001X0Y 00110001 11XXXYYY
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3 );
-            regs = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
-            aux.instr = {ext , 0x31 , regs};
-        break;
-        case 4: // XOR reg, im32
-            if(reg_x == 1){
-                aux.instr = {0x48 , 0x35};
-            } else{
-                ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-                regs = (0b11110000) | ((reg_x & 0x7));
-                aux.instr = {ext , 0x81 , regs};
-            }
-            
-            for(uint8_t idx = 0; idx < 4; idx++){
-                byte = ((0xFF000000 >> 8*idx) & randomValue)>>(8*(3-idx));
-                aux.instr.push_back(byte);
-            }
-        break;
-
-        case 5: //ADD reg, reg
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3 );
-            regs = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
-            aux.instr = {ext , 0x01 , regs};
-        break;
-        case 6: //ADD reg, im32
-            if(reg_x == 1){
-                aux.instr = {0x48 , 0x05};
-            } else{
-                ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-                regs = (0b11000000) | ((reg_x & 0x7));
-                aux.instr = {ext , 0x81 , regs};
-            }
-            
-            for(uint8_t idx = 0; idx < 4; idx++){
-                byte = ((0xFF000000 >> 8*idx) & randomValue)>>(8*(3-idx));
-                aux.instr.push_back(byte);
-            }
-        break;
-
-        case 7: //BSWAP reg - Byte Swap
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11001000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0x0F , regs };
-        break;
-
-        case 8: //NOT reg - One's Complement Negation
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11010000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0xF7 , regs };
-        break;
-
-        case 9: //NEG reg - Two's Complement Negation
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11011000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0xF7 , regs };
-        break;
-
-        case 10: //NEG reg - Two's Complement Negation
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-            regs = (0b11001000) | ((reg_x & 0x7));
-            aux.instr = {ext , 0xFF , regs };
-        break;
-
-        case 11: //AND
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3 );
-            regs = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
-            aux.instr = {ext , 0x21 , regs};
-        break;
-        case 12: // AND reg, im32
-            if(reg_x == 1){
-                aux.instr = {0x48 , 0x0D};
-            } else{
-                ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-                regs = (0b11001000) | ((reg_x & 0x7));
-                aux.instr = {ext , 0x81 , regs};
-            }
-            
-            for(uint8_t idx = 0; idx < 4; idx++){
-                byte = ((0xFF000000 >> 8*idx) & randomValue)>>(8*(3-idx));
-                aux.instr.push_back(byte);
-            }
-        break;
-
-        case 13: //OR reg, reg
-            ext  = (0b01001000) | ((reg_x & 0x8) >> 1) | ((reg_y & 0x8) >> 3 );
-            regs = (0b11000000) | ((reg_x & 0x7) << 3) | (reg_y & 0x7);
-            aux.instr = {ext , 0x09 , regs};
-        break;
-        case 14: // OR reg, im32
-
-            if(reg_x == 1){
-                aux.instr = {0x48 , 0x25};
-            } else{
-                ext  = (0b01001000) | ((reg_x & 0x8) >> 3);
-                regs = (0b11100000) | ((reg_x & 0x7));
-                aux.instr = {ext , 0x81 , regs};
-            }
-            
-            for(uint8_t idx = 0; idx < 4; idx++){
-                byte = ((0xFF000000 >> 8*idx) & randomValue)>>(8*(3-idx));
-                aux.instr.push_back(byte);
-            }
-
-        break;
-
-        case 15: // CLC — Clear Carry Flag
-            aux.instr = {0xF8};
-        break;
+    if(gene.imm_offset != 0){
+        uint32_t randomValue = generateRandomNumber(0, RAND_MAX); // a random value to add when a IM32 is needed
+        memcpy(aux.instr + gene.imm_offset, &randomValue, sizeof(randomValue));
     }
-
-    aux.size = aux.instr.size();
 }
 
 // Mutate the chromossome adding a new gene
@@ -550,7 +759,7 @@ uint32_t getChromossomeSize(Chromossome &chromossome){
     return size;
 }
 
-// Sets the action that the signal handler is going to make when it catches a signal
+// NOT USED. Sets the action that the signal handler is going to make when it catches a signal
 static void sigaction_sigfpe(int signal, siginfo_t *si, void *arg){
     ucontext_t *ctx = (ucontext_t *)arg;
 
@@ -561,7 +770,7 @@ static void sigaction_sigfpe(int signal, siginfo_t *si, void *arg){
 
 }
 
-// Catches the SIGFPE signal and jumps 6 bytes (the action is in the fucntion referenced by sa_sigaction) 
+// NOT USED. Catches the SIGFPE signal and jumps 6 bytes (the action is in the fucntion referenced by sa_sigaction) 
 void setSignalHanlder(int32_t signo){
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
@@ -598,10 +807,862 @@ void addSourceCodeToArray(uint8_t *sourcecode, FILE *file){
     }
 }
 
+// Reads a file of hex bytes (like code.hex) into a new array. n receives the number of bytes read
+uint8_t* readHexFile(const char *filename, uint32_t &n){
+
+    uint32_t bytes;
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) return NULL;
+
+    n = 0;
+    while ((fscanf(file, "%2x", &bytes)) != EOF) n++;
+    rewind(file);
+
+    uint8_t* code = (uint8_t*) malloc(n*sizeof( uint8_t ));
+    uint32_t l = 0;
+    while ((fscanf(file, "%2x", &bytes)) != EOF) code[l++] = (uint8_t) bytes;
+
+    fclose(file);
+    return code;
+}
+
+// A counter based generator, so any input of the corpus can be built alone from (seed, index)
+static inline uint64_t splitmix64(uint64_t x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static const uint64_t edge_bases[] = {0, 1, 2, 3, 0xFFFFFFFF, 0x100000000, 0x7FFFFFFFFFFFFFFF, 0x8000000000000000, UINT64_MAX - 1, UINT64_MAX};
+static const uint64_t edge_exponents[] = {0, 1, 2, MAX_VALIDATION_EXPONENT - 1, MAX_VALIDATION_EXPONENT};
+static const uint64_t edge_modulus[] = {0, 1, 2, 3, 10, 0xFFFFFFFF, 0x100000000, 0x8000000000000000, UINT64_MAX - 1, UINT64_MAX};
+#define N_EDGE_INPUTS (sizeof(edge_bases)/sizeof(uint64_t) * sizeof(edge_exponents)/sizeof(uint64_t) * sizeof(edge_modulus)/sizeof(uint64_t))
+
+// Builds the input at position index of the corpus. The edge cases (zero modulus, n = 0, 64 bit boundaries) come first,
+// then random inputs with random bit widths so that small and large values are both common
+void getValidationInput(uint64_t seed, uint64_t index, ValidationInput &input){
+
+    const uint32_t n_bases = sizeof(edge_bases)/sizeof(uint64_t);
+    const uint32_t n_exponents = sizeof(edge_exponents)/sizeof(uint64_t);
+    const uint32_t n_modulus = sizeof(edge_modulus)/sizeof(uint64_t);
+
+    if(index < N_EDGE_INPUTS){
+        input.b = edge_bases[index % n_bases];
+        input.n = edge_exponents[(index / n_bases) % n_exponents];
+        input.p = edge_modulus[(index / (n_bases * n_exponents)) % n_modulus];
+        return;
+    }
+
+    uint64_t key = splitmix64(seed ^ splitmix64(index));
+    uint64_t widths = splitmix64(key + 1);
+    input.b = splitmix64(key + 2) >> (widths & 63);
+    input.p = splitmix64(key + 3) >> ((widths >> 6) & 63);
+    input.n = ((widths >> 32) % (MAX_VALIDATION_EXPONENT + 1)) >> ((widths >> 12) & 3);
+}
+
+// Native version of the input code (a = 1; repeat n times: a = a * b mod p), by square and multiply so that any n
+// is fast. Returns 0 when the input code divides by zero
+uint8_t referenceModexp(const ValidationInput &input, uint64_t &result){
+
+    if(input.n == 0){
+        result = 1;     // the loop does not run, not even "1 mod p"
+        return 1;
+    }
+    if(input.p == 0) return 0;
+
+    uint64_t a = 1 % input.p, base = input.b % input.p;
+    for(uint64_t n = input.n; n > 0; n >>= 1){
+        if(n & 1) a = (uint64_t)(((unsigned __int128) a * base) % input.p);
+        base = (uint64_t)(((unsigned __int128) base * base) % input.p);
+    }
+    result = a;
+    return 1;
+}
+
+// Runs one input in the code and in the reference. Returns 1 if they agree, otherwise fills divergence and returns 0
+uint8_t checkValidationInput(jit_function_t jit, const ValidationInput &input, Divergence &divergence){
+
+    uint64_t expected = 0;
+    uint8_t expect_fault = !referenceModexp(input, expected);
+    return checkCodeOutput(jit, input, expected, expect_fault, divergence);
+}
+
+// Runs one input in the code and compares it with an already known result of the reference
+uint8_t checkCodeOutput(jit_function_t jit, const ValidationInput &input, uint64_t expected, uint8_t expect_fault, Divergence &divergence){
+
+    uint64_t got = 0, clobbered = 0;
+
+    if(current_runner != NULL) current_runner->input_seq++;
+
+    int32_t sig = sigsetjmp(validation_jmp, 0);
+    if(sig == 0){
+        validation_in_jit = 1;
+        got = callJitFunction(jit, input.b, input.n, input.p, &clobbered);
+        validation_in_jit = 0;
+        if(clobbered){
+            divergence.kind = DIVERGENCE_CLOBBER;
+        }else if(!expect_fault && got == expected){
+            return 1;
+        }else{
+            divergence.kind = expect_fault ? DIVERGENCE_NO_FAULT : DIVERGENCE_RESULT;
+        }
+    }else{
+        validation_in_jit = 0;
+        if(expect_fault && sig == SIGFPE) return 1;
+        divergence.kind = sig == SIGUSR1 ? DIVERGENCE_TIMEOUT : DIVERGENCE_FAULT;
+        got = sig;
+    }
+
+    divergence.input = input;
+    divergence.expected = expected;
+    divergence.got = got;
+    return 0;
+}
+
+// Looks for a smaller input (n, then b and p) that still diverges, so the report is easier to debug. Each field is
+// binary searched between 0 and its failing value, which always keeps a failing input even when the failures are not
+// contiguous. At most MAX_SHRINK_STEPS inputs are tried, for up to MAX_SHRINK_MS, and the smallest failing input found
+// by then is kept. It must run in a watched thread: a candidate that times out is just not a smaller failure
+void shrinkDivergence(jit_function_t jit, Divergence &divergence){
+
+    uint64_t ValidationInput::*fields[] = {&ValidationInput::n, &ValidationInput::b, &ValidationInput::p};
+    uint64_t deadline = getMonotonicMilliseconds() + MAX_SHRINK_MS;
+    uint32_t steps = 0;
+
+    uint8_t shrunk = 1;
+    while(shrunk){
+        shrunk = 0;
+        for(auto field : fields){
+            uint64_t low = 0, high = divergence.input.*field;  // high always diverges
+            while(low < high){
+                if(steps++ >= MAX_SHRINK_STEPS || getMonotonicMilliseconds() >= deadline) return;
+
+                ValidationInput candidate = divergence.input;
+                candidate.*field = low + (high - low) / 2;
+
+                Divergence aux = divergence;
+                if(!checkValidationInput(jit, candidate, aux) && aux.kind == divergence.kind){
+                    divergence = aux;
+                    high = candidate.*field;
+                    shrunk = 1;
+                }else{
+                    low = candidate.*field + 1;
+                }
+            }
+        }
+    }
+}
+
+// Makes the calling thread the one watched by watch
+void startRunnerWatch(runner_watch_t &watch){
+    watch.thread = pthread_self();
+    watch.input_seq = 0;
+    watch.interrupt_seq = UINT64_MAX;
+    watch.last_seq = 0;
+    watch.last_change = getMonotonicMilliseconds();
+    current_runner = &watch;
+    watch.busy = 1;
+}
+
+// Interrupts the watched thread if it has been in the same input for timeout_ms. Called periodically by the watcher
+void watchRunner(runner_watch_t &watch, uint64_t now, uint64_t timeout_ms){
+
+    uint64_t seq = watch.input_seq;
+    if(!watch.busy || seq != watch.last_seq){
+        watch.last_seq = seq;
+        watch.last_change = now;
+    }else if(now - watch.last_change >= timeout_ms){
+        watch.interrupt_seq = seq;
+        watch.last_change = now;
+        pthread_kill(watch.thread, SIGUSR1);
+    }
+}
+
+// Checks the inputs [begin, end) of the corpus in order and stops at the first divergence, or when another thread
+// found an earlier one
+void validateInputs(jit_function_t jit, uint64_t seed, uint64_t begin, uint64_t end, uint64_t *first_failure, Divergence &divergence){
+
+    ValidationInput input;
+    for(uint64_t i = begin; i < end; i++){
+        if(i >= __atomic_load_n(first_failure, __ATOMIC_RELAXED)) break;
+
+        getValidationInput(seed, i, input);
+        if(!checkValidationInput(jit, input, divergence)){
+            divergence.index = i;
+
+            uint64_t first = __atomic_load_n(first_failure, __ATOMIC_RELAXED);
+            while(i < first && !__atomic_compare_exchange_n(first_failure, &first, i, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            break;
+        }
+    }
+}
+
+// Checks the inputs of one shard
+void *pthreadValidateShard(void* _args){
+
+    validation_arg_t *args = (validation_arg_t*) _args;
+    startRunnerWatch(args->watch);
+    validateInputs(args->jit, args->seed, args->begin, args->end, args->first_failure, args->divergence);
+    args->watch.busy = 0;
+    args->done = 1;
+    pthread_exit(NULL);
+}
+
+// Runs shrinkDivergence() on args->divergence in a watched thread
+void *pthreadShrinkDivergence(void* _args){
+
+    validation_arg_t *args = (validation_arg_t*) _args;
+    startRunnerWatch(args->watch);
+    shrinkDivergence(args->jit, args->divergence);
+    args->watch.busy = 0;
+    args->done = 1;
+    pthread_exit(NULL);
+}
+
+// Waits for all the workers, interrupting the ones that stay in the same input for longer than timeout_ms
+void superviseValidation(validation_arg_t *workers, uint32_t n_workers, pthread_t *threads, uint64_t timeout_ms){
+
+    uint32_t running = n_workers;
+    while(running > 0){
+        usleep(1000);
+        uint64_t now = getMonotonicMilliseconds();
+        running = 0;
+
+        for(uint32_t w = 0; w < n_workers; w++){
+            if(workers[w].done) continue;
+            watchRunner(workers[w].watch, now, timeout_ms);
+            running++;
+        }
+    }
+
+    for(uint32_t w = 0; w < n_workers; w++){
+        pthread_join(threads[w], NULL);
+    }
+}
+
+// Jumps back to checkCodeOutput() when the code being validated raises a signal. A SIGUSR1 (timeout) only
+// counts if it was sent for the input being run. Outside of the code, a fault gets the default action back
+// (so it is not hidden) and SIGUSR1 is ignored
+static void sigaction_validation(int sig, siginfo_t *si, void *arg){
+    if(validation_in_jit){
+        if(sig != SIGUSR1 || (current_runner != NULL && current_runner->interrupt_seq == current_runner->input_seq)){
+            siglongjmp(validation_jmp, sig);
+        }
+        return;
+    }
+    if(sig != SIGUSR1){
+        signal(sig, SIG_DFL);
+    }
+}
+
+// SA_NODEFER leaves the signal unblocked after the siglongjmp, so sigsetjmp does not need to save the signal mask
+void setValidationSignalHandlers(){
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_sigaction = sigaction_validation;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigaction(SIGFPE, &sa, NULL);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGILL, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+// Compares the code against referenceModexp() for n_inputs inputs, split across all cores. Returns 1 if all of them agree
+uint8_t validateCode(uint8_t *code, uint32_t n, uint64_t n_inputs, uint64_t seed, FILE *out){
+
+    uint32_t length = ((n + sysconf(_SC_PAGE_SIZE) - 1) / sysconf(_SC_PAGE_SIZE)) * sysconf(_SC_PAGE_SIZE);
+    void * memory = mmap (NULL , length , PROT_READ | PROT_WRITE , MAP_PRIVATE | MAP_ANONYMOUS , -1 , 0);
+    memcpy ( memory , ( void *) ( code ) , sizeof(uint8_t)*n );
+    mprotect ( memory , length , PROT_READ | PROT_EXEC );
+
+    uint32_t n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n_workers < 1) n_workers = 1;
+
+    std::vector<validation_arg_t> workers(n_workers);
+    std::vector<pthread_t> threads(n_workers);
+
+    uint64_t first_failure = UINT64_MAX;
+    setValidationSignalHandlers();
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(uint32_t w = 0; w < n_workers; w++){
+        workers[w].jit = (jit_function_t) memory;
+        workers[w].seed = seed;
+        workers[w].first_failure = &first_failure;
+        workers[w].begin = n_inputs * w / n_workers;
+        workers[w].end = n_inputs * (w + 1) / n_workers;
+        workers[w].watch.busy = 0;
+        workers[w].done = 0;
+        workers[w].divergence.kind = DIVERGENCE_NONE;
+        pthread_create( &threads[w], NULL, pthreadValidateShard, &workers[w]);
+    }
+    superviseValidation(workers.data(), n_workers, threads.data(), timeout * 1000);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // the shards are in order, so the first worker with a divergence has the earliest one
+    Divergence *divergence = NULL;
+    for(auto &worker : workers){
+        if(worker.divergence.kind != DIVERGENCE_NONE && worker.divergence.index == first_failure){
+            divergence = &worker.divergence;
+            break;
+        }
+    }
+
+    if(divergence != NULL && divergence->kind != DIVERGENCE_TIMEOUT){
+        validation_arg_t shrink = workers[0];
+        shrink.divergence = *divergence;
+        shrink.watch.busy = 0;
+        shrink.done = 0;
+        pthread_create( &threads[0], NULL, pthreadShrinkDivergence, &shrink);
+        superviseValidation(&shrink, 1, threads.data(), timeout * 1000);
+        *divergence = shrink.divergence;
+    }
+    printValidationReport(out, n_inputs, seed, elapsed, n_workers, divergence);
+
+    munmap ( memory , length ) ;
+    return divergence == NULL;
+}
+
+// Prints the result of a validation: divergence is the (shrunk) earliest one, or NULL if it passed
+void printValidationReport(FILE *out, uint64_t n_inputs, uint64_t seed, double elapsed, uint32_t n_threads, const Divergence *divergence){
+
+    if(divergence == NULL){
+        fprintf(out, "Validation passed: %lu inputs (seed %lu) in %.2fs using %u threads\n", n_inputs, seed, elapsed, n_threads);
+    }else{
+        const char *kinds[] = {"none", "wrong result", "unexpected signal", "missing SIGFPE", "timeout", "callee-saved register changed"};
+        fprintf(out, "Validation failed at input %lu (seed %lu) after %.2fs: %s\n", divergence->index, seed, elapsed, kinds[divergence->kind]);
+        fprintf(out, "Minimal failing input: b = %lu, n = %lu, p = %lu\n", divergence->input.b, divergence->input.n, divergence->input.p);
+        if(divergence->kind == DIVERGENCE_RESULT){
+            fprintf(out, "Expected %lu, got %lu\n", divergence->expected, divergence->got);
+        }else if(divergence->kind == DIVERGENCE_FAULT){
+            fprintf(out, "Expected %lu, got signal %lu\n", divergence->expected, divergence->got);
+        }
+    }
+}
+
+uint64_t getMonotonicMilliseconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Checks that every instruction of the code has a known size, otherwise addSourceCodeToVector() would not advance
+uint8_t isSourceCodeSupported(const uint8_t *sourcecode, uint32_t size){
+
+    uint32_t i = 0;
+    while(i < size){
+        uint8_t j = getSizeOfInstruction(sourcecode[i]);
+        if(j == 0 || i + j > size) return 0;
+        i += j;
+    }
+    return 1;
+}
+
+// Checks that every jump lands inside the code and at the start of an instruction, otherwise mapJumpLocationsAux()
+// would walk out of the vector. remapJumpLocations() also expects the forward jumps to be "jcc rel32" (0F 8X) and
+// the backward ones to be "jmp rel32" (E9)
+uint8_t areJumpsSupported(const std::vector<Instruction> &vec){
+
+    std::vector<int64_t> starts;
+    int64_t total = 0;
+    for(auto &elem : vec){
+        starts.push_back(total);
+        total += elem.size;
+    }
+
+    for(uint32_t line = 0; line < vec.size(); line++){
+        const Instruction &elem = vec[line];
+        int32_t value;
+
+        if(elem.instr[0] == 0xE9){
+            memcpy(&value, elem.instr + 1, sizeof(value));
+            if(value >= 0) return 0;
+        }else if(elem.instr[0] == 0x0F){
+            if(elem.instr[1] < 0x80 || elem.instr[1] > 0x8F) return 0;
+            memcpy(&value, elem.instr + 2, sizeof(value));
+            if(value <= 0) return 0;
+        }else{
+            continue;
+        }
+
+        int64_t target = starts[line] + elem.size + value;
+        if(target < 0 || target >= total) return 0;
+        if(!std::binary_search(starts.begin(), starts.end(), target)) return 0;
+    }
+    return 1;
+}
+
+// Decodes the code into a chromossome with its jump metadata. The result is kept for the MAX_DECODED_CACHE most recently
+// used codes, so a repeated input is decoded only once
+uint8_t decodeSourceCode(const std::vector<uint8_t> &sourcecode, Chromossome &chromossome){
+
+    std::string key(sourcecode.begin(), sourcecode.end());
+
+    // the copies can throw std::bad_alloc, which must not leave the mutex locked
+    pthread_mutex_lock(&decoded_cache_mutex);
+    auto it = decoded_cache.find(key);
+    if(it != decoded_cache.end()){
+        decoded_lru.splice(decoded_lru.begin(), decoded_lru, it->second.lru);
+        try{
+            chromossome = it->second.chromossome;
+        }catch(const std::bad_alloc &){
+            pthread_mutex_unlock(&decoded_cache_mutex);
+            throw;
+        }
+        pthread_mutex_unlock(&decoded_cache_mutex);
+        return 1;
+    }
+    pthread_mutex_unlock(&decoded_cache_mutex);
+
+    if(!isSourceCodeSupported(sourcecode.data(), sourcecode.size())) return 0;
+
+    Chromossome decoded;
+    addSourceCodeToVector((uint8_t*) sourcecode.data(), decoded.chromossome, sourcecode.size());
+    //FIXME: mutate() inserts between the 11 first and 11 last instructions
+    if(decoded.chromossome.size() < 22) return 0;
+    if(!areJumpsSupported(decoded.chromossome)) return 0;
+    mapJumpLocations(decoded.chromossome, decoded.metadata);
+
+    pthread_mutex_lock(&decoded_cache_mutex);
+    if(decoded_cache.find(key) == decoded_cache.end()){ // another client may have decoded the same code meanwhile
+        try{
+            decoded_lru.push_front(key);
+            try{
+                decoded_cache.emplace(key, DecodedCacheEntry{decoded, decoded_lru.begin()});
+            }catch(const std::bad_alloc &){
+                decoded_lru.pop_front();
+                throw;
+            }
+            if(decoded_cache.size() > MAX_DECODED_CACHE){
+                decoded_cache.erase(decoded_lru.back());
+                decoded_lru.pop_back();
+            }
+        }catch(const std::bad_alloc &){
+            // the cache is only a shortcut, the code was decoded anyway
+        }
+    }
+    pthread_mutex_unlock(&decoded_cache_mutex);
+
+    chromossome = decoded;
+    return 1;
+}
+
+// Reads a job in the format:
+//   JOB N_GENERATIONS N_MUTATIONS N_ALLOWED_GENES SEED N_VALIDATION_INPUTS
+//   TEST b n p                 (zero or more, 2 12 10 if none is given, n up to MAX_VALIDATION_EXPONENT)
+//   CODE N_BYTES
+//   hex bytes, like code.hex
+uint8_t readJob(FILE *in, Job &job, std::vector<uint8_t> &sourcecode){
+
+    char line[256];
+    uint32_t n_bytes = 0;
+
+    if(fgets(line, sizeof(line), in) == NULL) return 0;
+    if(sscanf(line, "JOB %u %u %u %lu %lu", &job.n_generations, &job.n_mutations, &job.n_allowed_genes,
+              &job.seed, &job.n_validation_inputs) != 5) return 0;
+    if(job.n_generations > MAX_JOB_GENERATIONS || job.n_mutations > MAX_JOB_MUTATIONS ||
+       job.n_allowed_genes > MAX_JOB_ALLOWED_GENES || job.n_validation_inputs > MAX_JOB_VALIDATION_INPUTS) return 0;
+
+    while(fgets(line, sizeof(line), in) != NULL){
+        FitnessTest test;
+        if(sscanf(line, "TEST %lu %lu %lu", &test.input.b, &test.input.n, &test.input.p) == 3){
+            // the code loops n times, a larger n would only time out
+            if(job.tests.size() >= MAX_JOB_TESTS || test.input.n > MAX_VALIDATION_EXPONENT) return 0;
+            job.tests.push_back(test);
+        }else if(sscanf(line, "CODE %u", &n_bytes) == 1){
+            break;
+        }else{
+            return 0;
+        }
+    }
+    if(n_bytes == 0 || n_bytes > MAX_JOB_BYTES) return 0;
+
+    // fscanf() would wait for one more character after the last byte, so the bytes are read by hand
+    for(uint32_t i = 0; i < n_bytes; i++){
+        int32_t c;
+        while((c = fgetc(in)) == ' ' || c == '\t' || c == '\r' || c == '\n');
+        char hex[3] = {(char) c, (char) fgetc(in), 0};
+        if(!isxdigit(hex[0]) || !isxdigit(hex[1])) return 0;
+        sourcecode.push_back((uint8_t) strtoul(hex, NULL, 16));
+    }
+
+    if(job.tests.empty()){
+        for(const ValidationInput &input : default_fitness_inputs) job.tests.push_back({input, 0, 0});
+    }
+    for(auto &test : job.tests){
+        test.expect_fault = !referenceModexp(test.input, test.expected);
+    }
+    return 1;
+}
+
+// Mutates one chromossome of the job and runs it against the fitness suite. Returns 1 if the child is apt
+uint8_t evaluateTask(evaluator_t &evaluator, Job &job, uint32_t task){
+
+    Chromossome child = job.population[task / job.n_mutations];
+
+    // the mutation depends only on the job seed, so a job gives the same output no matter which worker runs it
+    random_seed = (uint32_t) splitmix64(job.seed ^ splitmix64(((uint64_t) job.generation << 32) | task));
+    mutate(child);
+
+    openArena(evaluator, getChromossomeSize(child));
+    copyVectorToArray(evaluator.arena, child.chromossome);
+    mprotect ( evaluator.arena , evaluator.arena_length , PROT_READ | PROT_EXEC );
+
+    Divergence divergence;
+    uint8_t apt = 1;
+    evaluator.watch.busy = 1;
+    for(auto &test : job.tests){
+        if(!checkCodeOutput((jit_function_t) evaluator.arena, test.input, test.expected, test.expect_fault, divergence)){
+            apt = 0;
+            break;
+        }
+    }
+    evaluator.watch.busy = 0;
+
+    if(apt) job.children[task] = std::move(child);
+    return apt;
+}
+
+// Checks one slice of the validation corpus with the output code of the job
+void validateTask(evaluator_t &evaluator, Job &job, uint32_t task){
+
+    Divergence divergence;
+    divergence.kind = DIVERGENCE_NONE;
+
+    uint64_t begin = (uint64_t) task * VALIDATION_TASK_INPUTS;
+    uint64_t end = std::min(begin + VALIDATION_TASK_INPUTS, job.n_validation_inputs);
+    if(begin >= __atomic_load_n(&job.first_failure, __ATOMIC_RELAXED)) return; // an earlier task already failed
+
+    openArena(evaluator, job.output.size());
+    memcpy(evaluator.arena, job.output.data(), job.output.size());
+    mprotect ( evaluator.arena , evaluator.arena_length , PROT_READ | PROT_EXEC );
+
+    evaluator.watch.busy = 1;
+    validateInputs((jit_function_t) evaluator.arena, job.seed, begin, end, &job.first_failure, divergence);
+    evaluator.watch.busy = 0;
+
+    // first_failure only goes down, so the task that lowered it last keeps its divergence
+    if(divergence.kind != DIVERGENCE_NONE){
+        pthread_mutex_lock(&scheduler_mutex);
+        if(divergence.index == job.first_failure) job.failure = divergence;
+        pthread_mutex_unlock(&scheduler_mutex);
+    }
+}
+
+// Shrinks the failing input of the job. A candidate that times out is just not a smaller failure
+void shrinkTask(evaluator_t &evaluator, Job &job){
+
+    openArena(evaluator, job.output.size());
+    memcpy(evaluator.arena, job.output.data(), job.output.size());
+    mprotect ( evaluator.arena , evaluator.arena_length , PROT_READ | PROT_EXEC );
+
+    evaluator.watch.busy = 1;
+    shrinkDivergence((jit_function_t) evaluator.arena, job.failure);
+    evaluator.watch.busy = 0;
+}
+
+// Takes tasks from the runnable jobs, one job at a time, so concurrent jobs share the cores evenly
+void *pthreadEvaluator(void* args){
+
+    evaluator_t &evaluator = *(evaluator_t*) args;
+    startRunnerWatch(evaluator.watch);
+    evaluator.watch.busy = 0;
+
+    while(true){
+        pthread_mutex_lock(&scheduler_mutex);
+        while(runnable_jobs.empty()){
+            pthread_cond_wait(&scheduler_cond, &scheduler_mutex);
+        }
+
+        Job *job = runnable_jobs.front();
+        runnable_jobs.pop_front();
+        uint32_t task = job->next_task++;
+        if(job->next_task < job->n_tasks){
+            runnable_jobs.push_back(job);
+        }
+        pthread_mutex_unlock(&scheduler_mutex);
+
+        // an allocation that fails only stops the job it was for, not the evaluator
+        try{
+            if(job->cancelled){
+                // the remaining tasks only have to be counted as finished
+            }else if(job->phase == JOB_PHASE_MUTATION){
+                job->apt[task] = evaluateTask(evaluator, *job, task);
+            }else if(job->phase == JOB_PHASE_VALIDATION){
+                validateTask(evaluator, *job, task);
+            }else{
+                shrinkTask(evaluator, *job);
+            }
+        }catch(const std::bad_alloc &){
+            job->cancelled = JOB_OUT_OF_MEMORY;
+        }
+
+        pthread_mutex_lock(&scheduler_mutex);
+        if(++job->finished_tasks == job->n_tasks){
+            pthread_cond_signal(&job->finished);
+        }
+        pthread_mutex_unlock(&scheduler_mutex);
+    }
+    return NULL;
+}
+
+// Interrupts (with SIGUSR1) an evaluator that stays in the same input for longer than evaluator_timeout_ms. The
+// signal names that input, so it is ignored if the evaluator has already moved on. The thread is not cancelled, so it
+// stays warm for the next task
+void *pthreadWatchEvaluators(void* args){
+
+    while(true){
+        usleep(1000);
+        uint64_t now = getMonotonicMilliseconds();
+        for(auto &evaluator : evaluators){
+            watchRunner(evaluator.watch, now, evaluator_timeout_ms);
+        }
+    }
+    return NULL;
+}
+
+// Runs the generations of a job in the evaluators and streams the progress and the result to out
+void runJob(Job &job, FILE *out){
+
+    uint32_t original_size = job.population[0].chromossome.size();
+
+    for(uint32_t gen = 0; gen < job.n_generations; gen++){
+
+        // the chromossomes of a generation all have the same size
+        uint64_t n_tasks = (uint64_t) job.population.size() * job.n_mutations;
+        uint64_t n_instructions = (uint64_t) job.population.size() * job.population[0].chromossome.size();
+        if(n_tasks > MAX_JOB_TASKS || n_instructions > MAX_JOB_POPULATION_INSTRUCTIONS){
+            fprintf(out, "ERROR population too large\n");
+            return;
+        }
+        job.generation = gen;
+        job.children.assign(n_tasks, Chromossome());
+        job.apt.assign(n_tasks, 0);
+        runJobTasks(job, JOB_PHASE_MUTATION, n_tasks);
+        if(job.cancelled){
+            if(job.cancelled == JOB_OUT_OF_MEMORY) fprintf(out, "ERROR out of memory\n");
+            return;
+        }
+
+        // same selection as the main loop, in the same order
+        std::vector<Chromossome> apt_list;
+        for(uint32_t i = 0; i < job.population.size(); i++){
+            for(uint32_t j = 0; j < job.n_mutations; j++){
+                uint32_t task = i * job.n_mutations + j;
+                if(job.apt[task]){
+                    apt_list.push_back(job.children[task]);
+                    if(apt_list.size() >= job.n_allowed_genes) break;
+                }
+            }
+        }
+        if(apt_list.size() > 0){
+            job.population = apt_list;
+        }
+
+        fprintf(out, "PROGRESS %u %lu\n", gen, apt_list.size());
+        if(fflush(out) != 0){
+            job.cancelled = JOB_CLIENT_GONE;
+            return;
+        }
+    }
+
+    fprintf(out, "CODE\n");
+    printInstructionVector(job.population[0].chromossome, out);
+    fprintf(out, "END\n");
+    fprintf(out, "INSERTED %lu\n", job.population[0].chromossome.size() - original_size);
+
+    // the validation also runs in the evaluators, as slices of the corpus in order, and the earliest failure is shrunk
+    Divergence *divergence = NULL;
+    if(job.n_validation_inputs > 0){
+        job.output.resize(getChromossomeSize(job.population[0]));
+        copyVectorToArray(job.output.data(), job.population[0].chromossome);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        uint32_t n_tasks = (job.n_validation_inputs + VALIDATION_TASK_INPUTS - 1) / VALIDATION_TASK_INPUTS;
+        job.first_failure = UINT64_MAX;
+        runJobTasks(job, JOB_PHASE_VALIDATION, n_tasks);
+        if(job.cancelled){
+            if(job.cancelled == JOB_OUT_OF_MEMORY) fprintf(out, "ERROR out of memory\n");
+            return;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        if(job.first_failure != UINT64_MAX){
+            if(job.failure.kind != DIVERGENCE_TIMEOUT) runJobTasks(job, JOB_PHASE_SHRINK, 1);
+            divergence = &job.failure;
+        }
+        printValidationReport(out, job.n_validation_inputs, job.seed, elapsed, evaluators.size(), divergence);
+    }
+    fprintf(out, "DONE %u\n", divergence == NULL ? 0 : 1);
+    fflush(out);
+}
+
+// Queues n_tasks tasks of the job in the given phase and waits until the evaluators finish all of them. Every
+// JOB_POLL_MS it checks the client, and once the job is cancelled the tasks not started yet are dropped
+void runJobTasks(Job &job, uint8_t phase, uint32_t n_tasks){
+
+    pthread_mutex_lock(&scheduler_mutex);
+    job.phase = phase;
+    job.n_tasks = n_tasks;
+    job.next_task = 0;
+    job.finished_tasks = 0;
+    if(n_tasks > 0){
+        runnable_jobs.push_back(&job);
+        pthread_cond_broadcast(&scheduler_cond);
+    }
+    while(job.finished_tasks < job.n_tasks){
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += JOB_POLL_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        if(pthread_cond_timedwait(&job.finished, &scheduler_mutex, &ts) == ETIMEDOUT && !job.cancelled && isClientGone(job.client_fd)){
+            job.cancelled = JOB_CLIENT_GONE;
+        }
+
+        // the tasks already taken by an evaluator still have to finish, since they use the job
+        if(job.cancelled && job.next_task < job.n_tasks){
+            job.n_tasks = job.next_task;
+            runnable_jobs.erase(std::remove(runnable_jobs.begin(), runnable_jobs.end(), &job), runnable_jobs.end());
+        }
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+// Returns 1 if the client closed its end of the connection. A client that only shut down its writes (as socat does
+// after sending the job) is still reading the answer
+uint8_t isClientGone(int32_t fd){
+
+    struct pollfd pfd = {fd, 0, 0};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR));
+}
+
+// Makes the arena of the evaluator writable and at least size bytes long. The caller copies the code to it and makes
+// it executable
+void openArena(evaluator_t &evaluator, uint32_t size){
+
+    if(size > evaluator.arena_length){
+        munmap ( evaluator.arena , evaluator.arena_length ) ;
+        evaluator.arena_length = ((size + sysconf(_SC_PAGE_SIZE) - 1) / sysconf(_SC_PAGE_SIZE)) * sysconf(_SC_PAGE_SIZE);
+        evaluator.arena = (uint8_t*) mmap (NULL , evaluator.arena_length , PROT_NONE , MAP_PRIVATE | MAP_ANONYMOUS , -1 , 0);
+    }
+    mprotect ( evaluator.arena , evaluator.arena_length , PROT_READ | PROT_WRITE );
+}
+
+// Reads the job of one client, runs it and closes the connection
+void *pthreadServeClient(void* args){
+
+    int32_t fd = (int32_t)(intptr_t) args;
+    FILE *in = fdopen(fd, "r");
+    FILE *out = fdopen(dup(fd), "w");
+
+    Job job;
+    std::vector<uint8_t> sourcecode;
+    job.population.push_back(Chromossome());
+    job.client_fd = fd;
+    job.cancelled = JOB_NOT_CANCELLED;
+    pthread_cond_init(&job.finished, NULL);
+
+    // runJob() waits for all the tasks it queues, so no evaluator still uses the job if it throws
+    try{
+        if(!readJob(in, job, sourcecode)){
+            fprintf(out, "ERROR invalid job\n");
+        }else if(!decodeSourceCode(sourcecode, job.population[0])){
+            fprintf(out, "ERROR unsupported code\n");
+        }else{
+            job.id = __atomic_add_fetch(&job_counter, 1, __ATOMIC_RELAXED);
+            fprintf(out, "ACCEPTED %u\n", job.id);
+            fflush(out);
+            runJob(job, out);
+        }
+    }catch(const std::bad_alloc &){
+        fprintf(out, "ERROR out of memory\n");
+    }
+
+    pthread_cond_destroy(&job.finished);
+    fclose(out);
+    fclose(in);
+    return NULL;
+}
+
+// Keeps one evaluator per core and serves jobs from clients connected to a Unix domain socket
+int32_t runServer(const char *socket_path){
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(addr.sun_path)){ printf("Erro: caminho do socket muito longo\n"); return EINVAL; }
+    strcpy(addr.sun_path, socket_path);
+
+    int32_t server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if(server_fd < 0 || bind(server_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(server_fd, SOMAXCONN) < 0){
+        perror("Erro: nao foi possivel abrir o socket");
+        return errno;
+    }
+
+    signal(SIGPIPE, SIG_IGN);   // a client that disconnects must not stop the server
+    setValidationSignalHandlers();
+
+    uint32_t n_evaluators = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n_evaluators < 1) n_evaluators = 1;
+    evaluators.resize(n_evaluators);
+
+    pthread_t thread;
+    for(auto &evaluator : evaluators){
+        evaluator.arena_length = sysconf(_SC_PAGE_SIZE);
+        evaluator.arena = (uint8_t*) mmap (NULL , evaluator.arena_length , PROT_NONE , MAP_PRIVATE | MAP_ANONYMOUS , -1 , 0);
+        evaluator.watch.busy = 0;
+        pthread_create( &thread, NULL, pthreadEvaluator, &evaluator);
+        pthread_detach(thread);
+    }
+    pthread_create( &thread, NULL, pthreadWatchEvaluators, NULL);
+    pthread_detach(thread);
+
+    printf("Listening on %s with %u evaluators\n", socket_path, n_evaluators);
+    fflush(stdout);
+
+    while(true){
+        int32_t client_fd = accept(server_fd, NULL, NULL);
+        if(client_fd < 0) continue;
+        pthread_create( &thread, NULL, pthreadServeClient, (void*)(intptr_t) client_fd);
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]){
 
+    if(argc >= 4 && argc <= 5 && strcmp(argv[1], "--validate") == 0){
+        uint32_t n = 0;
+        uint8_t *code = readHexFile(argv[2], n);
+        if (code == NULL){ printf("Erro: nao foi possivel abrir o arquivo\n"); return EINVAL; }
+
+        if(argc == 5) validation_seed = strtoull(argv[4], NULL, 10);
+        uint8_t passed = validateCode(code, n, strtoull(argv[3], NULL, 10), validation_seed);
+        free(code);
+        return passed ? 0 : 1;
+    }
+
+    if(argc == 3 && strcmp(argv[1], "--server") == 0){
+        return runServer(argv[2]);
+    }
+
     if(argc != 4){
         printf("Correct usage: ./main.bin N_GENERATIONS N_MUTATIONS N_ALLOWED_GENES\n");
+        printf("           or: ./main.bin --validate FILE N_INPUTS [SEED]\n");
+        printf("           or: ./main.bin --server SOCKET_PATH\n");
         exit(EINVAL);
     }else{
         N_GENERATIONS = atoi(argv[1]);
@@ -609,36 +1670,26 @@ int main(int argc, char *argv[]){
         N_ALLOWED_GENES = atoi(argv[3]);
     }
 
-    FILE *file;
-
     std::vector <Instruction> origin_vector;
     std::vector <Chromossome> population_list;
     
-    uint32_t bytes;
     void* retval = 0;
     uint32_t n = 0;
     Chromossome aux;
     population_list.push_back(aux); // just so it initializes 
 
-    file = fopen("code.hex", "r");
-    if (file == NULL){ printf("Erro: nao foi possivel abrir o arquivo\n"); return 0; }
-    else while ((fscanf(file, "%2x", &bytes)) != EOF) n++;
-    rewind(file);
-    
-    uint8_t* origin_code = (uint8_t*) malloc(n*sizeof( uint8_t ));  
-    uint32_t l = 0;
-    while ((fscanf(file, "%2x", &bytes)) != EOF) origin_code[l++] = (uint8_t) bytes;
-    
-    fclose(file);
+    uint8_t* origin_code = readHexFile("code.hex", n);
+    if (origin_code == NULL){ printf("Erro: nao foi possivel abrir o arquivo\n"); return 0; }
 
-    addSourceCodeToVector(origin_code, population_list[0].chromossome, n);
+    addSourceCodeToVector(origin_code, population_list[0].chromossome, n, 1);
     printf("Cromossomo inicial: \n");
     printInstructionVector(population_list[0].chromossome);
     mapJumpLocations(population_list[0].chromossome, population_list[0].metadata );
 
     uint32_t tamanho_original = population_list[0].chromossome.size();
 
-    srand((uint32_t) time(0));
+    random_seed = (uint32_t) time(0);
+    setValidationSignalHandlers();
 
     // repeat for N_GENERATIONS
     for(uint32_t gen = 0; gen < N_GENERATIONS; gen++){
@@ -668,12 +1719,12 @@ int main(int argc, char *argv[]){
                     isThreadRunnerAlive = 1;
                     pthread_create( &threadRunner, NULL, pthreadExecuteInMemory, &thread_args);
                     pthread_create( &threadWatcher, NULL, pthreadWaitOrKill, NULL);
+                    pthread_join(threadWatcher, NULL);  // first, so that it never signals a joined thread
                     pthread_join(threadRunner, &retval);
-                    pthread_join(threadWatcher, NULL);
                     //thread related
 
                     // compares with the expected result
-                    if((uint64_t) retval == 6){
+                    if((uint64_t) retval == 1){
                         apt_list.push_back(currentChromossome);
                         printf("Generation(%u) Chromossome(%u) Mutation(%u)\n",gen, i, j);
                         if(apt_list.size() >= N_ALLOWED_GENES){
@@ -700,7 +1751,13 @@ int main(int argc, char *argv[]){
     executeInMemory(population_list[0].chromossome);
     // free(origin_code);
 
-    return 0;
+    uint32_t chrom_size = getChromossomeSize(population_list[0]);
+    uint8_t *output_code = (uint8_t*) malloc(sizeof(uint8_t)*chrom_size);
+    copyVectorToArray(output_code, population_list[0].chromossome);
+    uint8_t passed = validateCode(output_code, chrom_size, N_VALIDATION_INPUTS, validation_seed);
+    free(output_code);
+
+    return passed ? 0 : 1;
 }
 
 // The original code is as follows:
@@ -709,7 +1766,7 @@ int main(int argc, char *argv[]){
 //     0x55 ,                                          // 0 push rbp
 //     0x48 , 0x89 , 0xE5 ,                            // 1 mov rbp, rsp
 //     0x48 , 0x89 , 0xD1 ,                            // 2 mov rcx, rdx (p)
-//     0x66 , 0xB8 , 0x01 , 0x00,                      // 3 mov(movi) ax, 1 (a=1)
+//     0xB8 , 0x01 , 0x00 , 0x00 , 0x00 ,              // 3 mov eax, 1 (a=1, also clears the upper bits of rax)
 //     0x4D , 0x31 , 0xC0 ,                            // 4 xor r8, r8 (i=0)
 //     0x49 , 0x39 , 0xF0 ,                            // 5 cmp r8, rsi (i?n)
 //     0x0F , 0x83 , 0x11 , 0x00 , 0x00 , 0x00 ,       // 6 jae 0x11 (i>=n end)